@@ -0,0 +1,208 @@
+#ifndef _GNU_SOURCE
+// NOTE: for pipe2(2)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLAG_IMPLEMENTATION
+#include "./flag.h"
+
+// End-to-end launch benchmark. Spawns bench_launch_child.c binaries and
+// measures the time from right before posix_spawn() to the moment the child
+// is done with flag_parse() and the help text, which includes exec, dynamic
+// linking, static initialization and the registration of every flag.
+
+// NOTE: keep in sync with bench_launch_child.c
+#define BENCH_HANDSHAKE_FD 3
+
+typedef struct {
+    uint64_t parsed_ns;
+    uint64_t flags_count;
+} Bench_Handshake;
+
+extern char **environ;
+
+void usage(FILE *stream)
+{
+    fprintf(stream, "Usage: ./bench-launch [OPTIONS] [--] <CHILD BINARIES...>\n");
+    fprintf(stream, "OPTIONS:\n");
+    flag_print_options(stream);
+}
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000*1000*1000 + (uint64_t) ts.tv_nsec;
+}
+
+// Spawns the child, waits for the handshake and stores the launch-to-parse-done time in elapsed
+bool launch(char **argv, Bench_Handshake *hs, uint64_t *elapsed)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        fprintf(stderr, "ERROR: could not create pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    // NOTE: dup2() onto the same fd doesn't clear O_CLOEXEC, so make sure the
+    // write end is not already sitting on the handshake fd
+    if (fds[1] == BENCH_HANDSHAKE_FD) {
+        int fd = fcntl(fds[1], F_DUPFD_CLOEXEC, BENCH_HANDSHAKE_FD + 1);
+        close(fds[1]);
+        fds[1] = fd;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], BENCH_HANDSHAKE_FD);
+
+    uint64_t begin = now_ns();
+    pid_t pid;
+    int err = posix_spawn(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (err != 0) {
+        fprintf(stderr, "ERROR: could not spawn %s: %s\n", argv[0], strerror(err));
+        close(fds[0]);
+        return false;
+    }
+
+    ssize_t n;
+    do {
+        n = read(fds[0], hs, sizeof(*hs));
+    } while (n < 0 && errno == EINTR);
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    if (n != (ssize_t) sizeof(*hs)) {
+        fprintf(stderr, "ERROR: %s did not finish the handshake, exit status %d\n",
+                argv[0], WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        return false;
+    }
+
+    *elapsed = hs->parsed_ns - begin;
+    return true;
+}
+
+// The index of the flag of the given type closest to near. See bench_launch_child.c
+size_t pick_flag(size_t flags_count, size_t near, size_t type)
+{
+    size_t i = near - near%4 + type;
+    while (i >= flags_count) i -= 4;
+    return i;
+}
+
+int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    bool *help = flag_bool("help", false, "Print this help to stdout and exit with 0");
+    size_t *launches = flag_size("launches", 20000, "Amount of times to launch every child binary");
+
+    if (!flag_parse(argc, argv)) {
+        usage(stderr);
+        flag_print_error(stderr);
+        exit(1);
+    }
+
+    if (*help) {
+        usage(stdout);
+        exit(0);
+    }
+
+    int rest_argc = flag_rest_argc();
+    char **rest_argv = flag_rest_argv();
+
+    if (rest_argc <= 0) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: no child binaries are provided\n");
+        exit(1);
+    }
+
+    if (*launches == 0) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: -%s must be at least 1\n", flag_name(launches));
+        exit(1);
+    }
+
+    uint64_t *samples = (uint64_t*) malloc(*launches*sizeof(*samples));
+    assert(samples);
+
+    for (int i = 0; i < rest_argc; ++i) {
+        Bench_Handshake hs;
+        uint64_t elapsed;
+
+        // NOTE: the warmup launch tells us how many flags the child has and
+        // gets the binary into the page cache
+        char *warmup_argv[] = {rest_argv[i], NULL};
+        if (!launch(warmup_argv, &hs, &elapsed)) exit(1);
+
+        size_t n = (size_t) hs.flags_count;
+        if (n < 4) {
+            fprintf(stderr, "ERROR: %s has %zu flags, expected at least 4\n", rest_argv[i], n);
+            exit(1);
+        }
+
+        // NOTE: a mix of all the flag types and both value syntaxes spread
+        // across the registry, so the lookups don't all hit the first entries
+        char args[6][64];
+        snprintf(args[0], sizeof(args[0]), "-flag%zu", pick_flag(n, 0, 0));
+        snprintf(args[1], sizeof(args[1]), "-flag%zu", pick_flag(n, n/2, 1));
+        snprintf(args[2], sizeof(args[2]), "-flag%zu=64M", pick_flag(n, n - 1, 2));
+        snprintf(args[3], sizeof(args[3]), "-flag%zu", pick_flag(n, n/4, 3));
+        snprintf(args[4], sizeof(args[4]), "-flag%zu=false", pick_flag(n, n*3/4, 0));
+        snprintf(args[5], sizeof(args[5]), "-flag%zu", pick_flag(n, n*3/4, 3));
+        char *child_argv[] = {
+            rest_argv[i],
+            args[0],
+            args[1], (char*) "1234567",
+            args[2],
+            args[3], (char*) "/var/lib/service/data",
+            args[4],
+            args[5], (char*) "production",
+            (char*) "--",
+            (char*) "input-0.txt",
+            (char*) "input-1.txt",
+            NULL,
+        };
+
+        for (size_t j = 0; j < *launches; ++j) {
+            if (!launch(child_argv, &hs, &samples[j])) exit(1);
+        }
+
+        qsort(samples, *launches, sizeof(*samples), compare_u64);
+
+        uint64_t sum = 0;
+        for (size_t j = 0; j < *launches; ++j) sum += samples[j];
+
+        static const double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+        printf("%s: %zu flags, %zu launches: mean %.1fus",
+               rest_argv[i], n, *launches, (double) sum/(double) *launches*1e-3);
+        for (size_t k = 0; k < sizeof(percentiles)/sizeof(percentiles[0]); ++k) {
+            size_t rank = (size_t) (percentiles[k]/100.0*(double) *launches);
+            if (rank >= *launches) rank = *launches - 1;
+            printf(" p%g %.1fus", percentiles[k], (double) samples[rank]*1e-3);
+        }
+        printf(" max %.1fus\n", (double) samples[*launches - 1]*1e-3);
+        fflush(stdout);
+    }
+
+    free(samples);
+    return 0;
+}
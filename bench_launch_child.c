@@ -0,0 +1,76 @@
+#ifndef _POSIX_C_SOURCE
+// NOTE: for clock_gettime(2) and open_memstream(3)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLAG_IMPLEMENTATION
+#include "./flag.h"
+
+// The program bench_launch.c spawns over and over again. Registers
+// BENCH_FLAGS_COUNT flags, parses argv, builds the help text and reports the
+// moment it's done through the handshake pipe.
+
+#ifndef BENCH_FLAGS_COUNT
+#define BENCH_FLAGS_COUNT 10
+#endif
+
+static_assert(BENCH_FLAGS_COUNT <= FLAGS_CAP, "Compile with -DFLAGS_CAP=BENCH_FLAGS_COUNT");
+
+// NOTE: keep in sync with bench_launch.c
+#define BENCH_HANDSHAKE_FD 3
+
+typedef struct {
+    uint64_t parsed_ns;
+    uint64_t flags_count;
+} Bench_Handshake;
+
+static char names[BENCH_FLAGS_COUNT][32];
+
+int main(int argc, char **argv)
+{
+    // NOTE: the types go round robin, so the parent can tell the type of
+    // flagN by N%4 and build a valid argv without asking us
+    for (size_t i = 0; i < BENCH_FLAGS_COUNT; ++i) {
+        snprintf(names[i], sizeof(names[i]), "flag%zu", i);
+        switch (i%4) {
+        case 0: flag_bool(names[i], false, "Benchmark bool flag"); break;
+        case 1: flag_uint64(names[i], i, "Benchmark uint64 flag"); break;
+        case 2: flag_size(names[i], i, "Benchmark size flag"); break;
+        case 3: flag_str(names[i], "default", "Benchmark str flag"); break;
+        }
+    }
+
+    if (!flag_parse(argc, argv)) {
+        flag_print_error(stderr);
+        return 1;
+    }
+
+    // NOTE: plenty of tools render their usage upfront, so it's ready for
+    // -help and error messages. Render it into memory to include that cost.
+    char *help = NULL;
+    size_t help_size = 0;
+    FILE *help_stream = open_memstream(&help, &help_size);
+    if (help_stream == NULL) return 1;
+    fprintf(help_stream, "Usage: %s [OPTIONS] [--] <INPUT FILES...>\n", argv[0]);
+    fprintf(help_stream, "OPTIONS:\n");
+    flag_print_options(help_stream);
+    fclose(help_stream);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    Bench_Handshake hs;
+    hs.parsed_ns = (uint64_t) ts.tv_sec*1000*1000*1000 + (uint64_t) ts.tv_nsec;
+    hs.flags_count = BENCH_FLAGS_COUNT;
+    if (write(BENCH_HANDSHAKE_FD, &hs, sizeof(hs)) != (ssize_t) sizeof(hs)) {
+        return 1;
+    }
+
+    free(help);
+    return 0;
+}
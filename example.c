@@ -1,9 +1,49 @@
+#ifndef _GNU_SOURCE
+// NOTE: for O_DIRECT and fallocate(2)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
 
 #define FLAG_IMPLEMENTATION
 #include "./flag.h"
 
+// NOTE: O_DIRECT requires the buffer address, the file offset and the length
+// of every write to be aligned to the logical block size of the device. 4096
+// covers all the block sizes we care about.
+#define DIRECT_ALIGN 4096
+#define CHUNK_SIZE (1024*1024)
+
+// NOTE: HDR-style log-linear histogram. Every power of two is split into
+// 2^STATS_SUB_BITS linear sub-buckets, so any recorded latency is off by at
+// most ~6% while the whole range of uint64_t nanoseconds fits into 976 buckets.
+#define STATS_SUB_BITS 4
+#define STATS_SUB_COUNT (1 << STATS_SUB_BITS)
+#define STATS_HIST_BUCKETS ((64 - STATS_SUB_BITS + 1)*STATS_SUB_COUNT)
+
+typedef struct {
+    const char *file_path;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint64_t writes;
+    uint64_t wall_ns;
+} File_Stats;
+
+typedef struct {
+    bool enabled;
+    File_Stats *files;
+    size_t files_count;
+    uint64_t write_hist[STATS_HIST_BUCKETS];
+    uint64_t write_max_ns;
+} Stats;
+
+static Stats stats;
+static File_Stats *current_file;
+
 void usage(FILE *stream)
 {
     fprintf(stream, "Usage: ./example [OPTIONS] [--] <OUTPUT FILES...>\n");
@@ -11,11 +51,305 @@ void usage(FILE *stream)
     flag_print_options(stream);
 }
 
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000*1000*1000 + (uint64_t) ts.tv_nsec;
+}
+
+size_t stats_bucket(uint64_t ns)
+{
+    if (ns < STATS_SUB_COUNT) return (size_t) ns;
+    size_t exp = STATS_SUB_BITS;
+    while (ns >> (exp + 1)) exp += 1;
+    uint64_t top = ns >> (exp - STATS_SUB_BITS);
+    return (exp - STATS_SUB_BITS + 1)*STATS_SUB_COUNT + (size_t) (top - STATS_SUB_COUNT);
+}
+
+// Highest latency that falls into the bucket
+uint64_t stats_bucket_value(size_t bucket)
+{
+    if (bucket < STATS_SUB_COUNT) return bucket;
+    size_t exp = bucket/STATS_SUB_COUNT + STATS_SUB_BITS - 1;
+    uint64_t top = bucket%STATS_SUB_COUNT + STATS_SUB_COUNT;
+    uint64_t width = (uint64_t) 1 << (exp - STATS_SUB_BITS);
+    return top*width + width - 1;
+}
+
+uint64_t stats_percentile(double p)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < STATS_HIST_BUCKETS; ++i) total += stats.write_hist[i];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t) (p/100.0*(double) total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_HIST_BUCKETS; ++i) {
+        seen += stats.write_hist[i];
+        if (seen > rank) {
+            uint64_t value = stats_bucket_value(i);
+            return value < stats.write_max_ns ? value : stats.write_max_ns;
+        }
+    }
+    return stats.write_max_ns;
+}
+
+void stats_syscall(void)
+{
+    if (current_file) current_file->syscalls += 1;
+}
+
+bool write_all(int fd, const char *buf, size_t size)
+{
+    while (size > 0) {
+        uint64_t begin = stats.enabled ? now_ns() : 0;
+        ssize_t n = write(fd, buf, size);
+        stats_syscall();
+        if (stats.enabled) {
+            uint64_t ns = now_ns() - begin;
+            stats.write_hist[stats_bucket(ns)] += 1;
+            if (ns > stats.write_max_ns) stats.write_max_ns = ns;
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        if (current_file) {
+            current_file->writes += 1;
+            current_file->bytes += (uint64_t) n;
+        }
+        buf += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+bool buffered_write(int fd, char *chunk, size_t *chunk_size, const char *data, size_t size)
+{
+    if (*chunk_size + size > CHUNK_SIZE) {
+        if (!write_all(fd, chunk, *chunk_size)) return false;
+        *chunk_size = 0;
+    }
+    if (size > CHUNK_SIZE) return write_all(fd, data, size);
+    memcpy(chunk + *chunk_size, data, size);
+    *chunk_size += size;
+    return true;
+}
+
+int open_file(const char *file_path, int flags)
+{
+    int fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC | flags, 0644);
+    stats_syscall();
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", file_path, strerror(errno));
+    }
+    return fd;
+}
+
+bool close_file(const char *file_path, int fd, bool ok)
+{
+    if (!ok) {
+        fprintf(stderr, "ERROR: could not write to file %s: %s\n", file_path, strerror(errno));
+    }
+
+    int err = close(fd);
+    stats_syscall();
+    if (err < 0 && ok) {
+        fprintf(stderr, "ERROR: could not close file %s: %s\n", file_path, strerror(errno));
+        ok = false;
+    }
+    return ok;
+}
+
+bool generate_lines(const char *file_path, const char *line, size_t count)
+{
+    int fd = open_file(file_path, 0);
+    if (fd < 0) return false;
+
+    char *chunk = (char*) malloc(CHUNK_SIZE);
+    assert(chunk);
+    size_t chunk_size = 0;
+    size_t line_len = strlen(line);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; ++i) {
+        ok = buffered_write(fd, chunk, &chunk_size, line, line_len)
+             && buffered_write(fd, chunk, &chunk_size, "\n", 1);
+    }
+    if (ok) ok = write_all(fd, chunk, chunk_size);
+
+    free(chunk);
+    return close_file(file_path, fd, ok);
+}
+
+size_t gcd(size_t a, size_t b)
+{
+    while (b != 0) {
+        size_t t = a%b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Fills buf with the line\n pattern starting phase bytes into it and returns
+// the phase the next buffer has to start with
+size_t fill_pattern(char *buf, size_t size, const char *line, size_t line_len, size_t phase)
+{
+    for (size_t i = 0; i < size; ++i) {
+        buf[i] = phase < line_len ? line[phase] : '\n';
+        phase = (phase + 1)%(line_len + 1);
+    }
+    return phase;
+}
+
+bool generate_bytes(const char *file_path, const char *line, size_t bytes, bool direct)
+{
+    int fd = open_file(file_path, direct ? O_DIRECT : 0);
+    if (fd < 0) return false;
+
+    // NOTE: preallocating the whole file upfront lets the filesystem hand out
+    // one contiguous extent instead of growing the file chunk by chunk.
+    if (bytes > 0) {
+        int err = fallocate(fd, 0, 0, (off_t) bytes);
+        stats_syscall();
+        if (err < 0) {
+            if (errno != EOPNOTSUPP) {
+                fprintf(stderr, "ERROR: could not preallocate %zu bytes for %s: %s\n", bytes, file_path, strerror(errno));
+                close(fd);
+                return false;
+            }
+            fprintf(stderr, "WARNING: %s: preallocation is not supported by the filesystem\n", file_path);
+        }
+    }
+
+    char *chunk = NULL;
+    if (posix_memalign((void**) &chunk, DIRECT_ALIGN, CHUNK_SIZE) != 0) {
+        fprintf(stderr, "ERROR: could not allocate memory\n");
+        close(fd);
+        return false;
+    }
+
+    // NOTE: if the chunk holds a whole number of lines it can be filled once
+    // and written over and over again. Otherwise every chunk is refilled
+    // starting from where the previous one left off, so no line gets broken
+    // at a chunk boundary.
+    size_t line_len = strlen(line);
+    size_t period = line_len + 1;
+    size_t lcm = period/gcd(period, DIRECT_ALIGN)*DIRECT_ALIGN;
+    size_t chunk_size = lcm <= CHUNK_SIZE ? CHUNK_SIZE/lcm*lcm : CHUNK_SIZE;
+    bool refill = chunk_size%period != 0;
+    size_t phase = fill_pattern(chunk, chunk_size, line, line_len, 0);
+
+    bool ok = true;
+    size_t left = bytes;
+    while (ok && left >= chunk_size) {
+        ok = write_all(fd, chunk, chunk_size);
+        left -= chunk_size;
+        if (refill) phase = fill_pattern(chunk, chunk_size, line, line_len, phase);
+    }
+
+    if (ok && left > 0) {
+        size_t aligned = direct ? left/DIRECT_ALIGN*DIRECT_ALIGN : left;
+        ok = write_all(fd, chunk, aligned);
+        if (ok && aligned < left) {
+            // NOTE: the tail is not a multiple of the block size, so O_DIRECT
+            // can't write it. Drop the flag and let it go through the page cache.
+            int fl = fcntl(fd, F_GETFL);
+            ok = fcntl(fd, F_SETFL, fl & ~O_DIRECT) == 0;
+            stats_syscall();
+            stats_syscall();
+            if (ok) ok = write_all(fd, chunk + aligned, left - aligned);
+        }
+    }
+
+    free(chunk);
+    return close_file(file_path, fd, ok);
+}
+
+double mib_per_sec(uint64_t bytes, uint64_t ns)
+{
+    return ns > 0 ? (double) bytes/(1024.0*1024.0)/((double) ns*1e-9) : 0.0;
+}
+
+void print_json_str(FILE *stream, const char *s)
+{
+    fputc('"', stream);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            fprintf(stream, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(stream, "\\u%04x", c);
+        } else {
+            fputc(c, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+static const double stats_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+#define STATS_PERCENTILES_COUNT (sizeof(stats_percentiles)/sizeof(stats_percentiles[0]))
+
+void print_stats(FILE *stream)
+{
+    File_Stats total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < stats.files_count; ++i) {
+        total.bytes    += stats.files[i].bytes;
+        total.syscalls += stats.files[i].syscalls;
+        total.writes   += stats.files[i].writes;
+        total.wall_ns  += stats.files[i].wall_ns;
+    }
+
+    fprintf(stream, "Stats: %zu files, %" PRIu64 " bytes, %" PRIu64 " syscalls (%" PRIu64 " writes), %.3fs, %.2f MiB/s\n",
+            stats.files_count, total.bytes, total.syscalls, total.writes,
+            (double) total.wall_ns*1e-9, mib_per_sec(total.bytes, total.wall_ns));
+    for (size_t i = 0; i < stats.files_count; ++i) {
+        File_Stats *fs = &stats.files[i];
+        fprintf(stream, "    %s: %" PRIu64 " bytes, %" PRIu64 " syscalls, %.3fs, %.2f MiB/s\n",
+                fs->file_path, fs->bytes, fs->syscalls,
+                (double) fs->wall_ns*1e-9, mib_per_sec(fs->bytes, fs->wall_ns));
+    }
+    fprintf(stream, "    write latency:");
+    for (size_t i = 0; i < STATS_PERCENTILES_COUNT; ++i) {
+        fprintf(stream, " p%g %.1fus", stats_percentiles[i], (double) stats_percentile(stats_percentiles[i])*1e-3);
+    }
+    fprintf(stream, " max %.1fus\n", (double) stats.write_max_ns*1e-3);
+}
+
+void print_stats_json(FILE *stream)
+{
+    fprintf(stream, "{\"files\":[");
+    for (size_t i = 0; i < stats.files_count; ++i) {
+        File_Stats *fs = &stats.files[i];
+        if (i > 0) fputc(',', stream);
+        fprintf(stream, "{\"path\":");
+        print_json_str(stream, fs->file_path);
+        fprintf(stream, ",\"bytes\":%" PRIu64 ",\"syscalls\":%" PRIu64 ",\"writes\":%" PRIu64 ",\"wall_ns\":%" PRIu64 "}",
+                fs->bytes, fs->syscalls, fs->writes, fs->wall_ns);
+    }
+    fprintf(stream, "],\"write_latency_ns\":{");
+    for (size_t i = 0; i < STATS_PERCENTILES_COUNT; ++i) {
+        fprintf(stream, "\"p%g\":%" PRIu64 ",", stats_percentiles[i], stats_percentile(stats_percentiles[i]));
+    }
+    fprintf(stream, "\"max\":%" PRIu64 "}}\n", stats.write_max_ns);
+}
+
 int main(int argc, char **argv)
 {
     bool *help = flag_bool("help", false, "Print this help to stdout and exit with 0");
     char **line = flag_str("line", "Hi!", "Line to output to the file");
     size_t *count = flag_size("count", 64, "Amount of lines to generate");
+    size_t *bytes = flag_size("bytes", 0, "Exact amount of bytes to generate. Overrides -count when not 0");
+    bool *direct = flag_bool("direct", false, "Bypass the page cache with O_DIRECT when generating -bytes");
+    bool *show_stats = flag_bool("stats", false, "Print bytes, syscalls, wall time and write latencies after generating");
+    bool *stats_json = flag_bool("stats-json", false, "Like -stats but print them as JSON instead");
 
     if (!flag_parse(argc, argv)) {
         usage(stderr);
@@ -37,19 +371,50 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    if (*direct && *bytes == 0) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: -%s only works together with -%s\n", flag_name(direct), flag_name(bytes));
+        exit(1);
+    }
+
+    File_Stats *files = (File_Stats*) calloc((size_t) rest_argc, sizeof(*files));
+    assert(files);
+    stats.enabled = *show_stats || *stats_json;
+
     for (int i = 0; i < rest_argc; ++i) {
         const char *file_path = rest_argv[i];
-        FILE *f = fopen(file_path, "w");
-        assert(f);
 
-        for (size_t i = 0; i < *count; ++i) {
-            fprintf(f, "%s\n", *line);
-        }
+        current_file = &files[i];
+        current_file->file_path = file_path;
+        uint64_t begin = now_ns();
+
+        bool ok = *bytes > 0
+                  ? generate_bytes(file_path, *line, *bytes, *direct)
+                  : generate_lines(file_path, *line, *count);
+        if (!ok) exit(1);
+
+        current_file->wall_ns = now_ns() - begin;
+        stats.files = files;
+        stats.files_count = (size_t) i + 1;
 
-        fclose(f);
+        // NOTE: with -stats-json stdout is reserved for the JSON document
+        if (*stats_json) continue;
+
+        if (*bytes > 0) {
+            printf("Generated %zu bytes in %s (%s) in %.3fs, %.2f MiB/s\n",
+                   *bytes, file_path, *direct ? "O_DIRECT" : "buffered",
+                   (double) current_file->wall_ns*1e-9, mib_per_sec(*bytes, current_file->wall_ns));
+        } else {
+            printf("Generated %" PRIu64 " lines in %s\n", *count, file_path);
+        }
+    }
 
-        printf("Generated %" PRIu64 " lines in %s\n", *count, file_path);
+    if (*stats_json) {
+        print_stats_json(stdout);
+    } else if (*show_stats) {
+        print_stats(stdout);
     }
 
+    free(files);
     return 0;
 }
@@ -16,12 +16,14 @@
 #include <string.h>
 #include <errno.h>
 
-// TODO: add support for -flag=x syntax
 // TODO: *_var function variants
 // void flag_bool_var(bool *var, const char *name, bool def, const char *desc);
 // void flag_bool_uint64(uint64_t *var, const char *name, bool def, const char *desc);
 // etc.
 // WARNING! *_var functions may break the flag_name() functionality
+// WARNING! flag_name() only works with the pointers returned by flag_bool(),
+// flag_uint64(), flag_size() and flag_str(). Passing it Flag_Bit.word compiles
+// but returns garbage, use flag_bit_name() for the flag_bit() flags.
 
 char *flag_name(void *val);
 bool *flag_bool(const char *name, bool def, const char *desc);
@@ -33,6 +35,94 @@ int flag_rest_argc(void);
 char **flag_rest_argv(void);
 void flag_print_error(FILE *stream);
 void flag_print_options(FILE *stream);
+void flag_print_snapshot(FILE *stream);
+
+// Boolean flags packed into a contiguous bank of uint64_t words. Every
+// flag_bit() takes the next bit of the bank, so the flags registered one after
+// another share words and can be checked together with a single load:
+//
+//     flag_bit_align();
+//     Flag_Bit a = flag_bit("a", false, "...");
+//     Flag_Bit b = flag_bit("b", false, "...");
+//     Flag_Bit ab = flag_bit_group(a, b);
+//     if (flag_bit_all(ab)) { ... }
+//
+// A group only works if all of its flags ended up in the same word. Which
+// word a flag lands in depends on every flag_bit() registered before it, so
+// call flag_bit_align() to start each group on a fresh word and keep groups
+// within 64 flags. flag_bit_group() exits with an error if the flags are in
+// different words anyway.
+//
+// The bits are parsed, printed and snapshotted exactly like flag_bool() flags.
+typedef struct {
+    uint64_t *word;
+    uint64_t mask;
+    size_t index; // of the flag in the registry, the first flag for groups
+} Flag_Bit;
+
+Flag_Bit flag_bit(const char *name, bool def, const char *desc);
+void flag_bit_align(void);
+Flag_Bit flag_bit_group(Flag_Bit a, Flag_Bit b);
+// The name of a flag_bit() flag, or of the first flag of a group
+char *flag_bit_name(Flag_Bit bit);
+
+// Whether any of the flags in bit are set
+static inline bool flag_bit_test(Flag_Bit bit)
+{
+    return (*bit.word & bit.mask) != 0;
+}
+
+// Whether all of the flags in bit are set
+static inline bool flag_bit_all(Flag_Bit bit)
+{
+    return (*bit.word & bit.mask) == bit.mask;
+}
+
+// Pull-style iteration over the flags in argv without touching the registry.
+// Useful for wrappers that only care about a few flags and forward the rest:
+//
+//     Flag_Iter it = flag_iter_begin(argc, argv);
+//     while (flag_iter_next(&it)) {
+//         if (it.name_len == 1 && *it.name == 'o') {
+//             output = flag_iter_shift_value(&it);
+//             flag_iter_consume(&it);
+//         } else if (it.name_len == 1 && *it.name == 'j') {
+//             // NOTE: forwarded, but its value still has to be shifted
+//             flag_iter_shift_value(&it);
+//         }
+//     }
+//     argc = flag_iter_forward_argv(&it); // argv now holds only what wasn't consumed
+//
+// The iterator knows nothing about the flags, so just like flag_parse() it
+// stops at the first token that doesn't start with a dash or is a lone "-".
+// Call flag_iter_shift_value() for every flag you know takes a separate
+// value, including the ones you forward. Otherwise its value is taken for the
+// first positional argument and nothing after it is iterated: with -j 4 -o out
+// the iteration ends at 4 and -o is never seen.
+//
+// The tokens the caller did not consume are compacted towards the beginning
+// of argv as the iteration goes, so don't rely on the contents of argv until
+// flag_iter_forward_argv() is called.
+typedef struct {
+    int argc;
+    char **argv;
+    int next;           // index of the next token to look at
+    int out;            // where the next unconsumed token is moved to
+    int rest;           // index of the first non-flag token once flag_iter_next() returns false
+
+    int index;          // index of the current flag token in argv
+    char *name;         // name of the current flag without the dash, NOT terminated at '='
+    size_t name_len;
+    char *value;        // value after '=', or the next token, or NULL if there is neither
+    bool value_inline;  // whether value came after '='
+    bool consumed;
+} Flag_Iter;
+
+Flag_Iter flag_iter_begin(int argc, char **argv);
+bool flag_iter_next(Flag_Iter *it);
+char *flag_iter_shift_value(Flag_Iter *it);
+void flag_iter_consume(Flag_Iter *it);
+int flag_iter_forward_argv(Flag_Iter *it);
 
 #endif // FLAG_H_
 
@@ -45,15 +135,17 @@ typedef enum {
     FLAG_UINT64,
     FLAG_SIZE,
     FLAG_STR,
+    FLAG_BIT,
     COUNT_FLAG_TYPES,
 } Flag_Type;
 
-static_assert(COUNT_FLAG_TYPES == 4, "Exhaustive Flag_Value definition");
+static_assert(COUNT_FLAG_TYPES == 5, "Exhaustive Flag_Value definition");
 typedef union {
     char *as_str;
     uint64_t as_uint64;
     bool as_bool;
     size_t as_size;
+    size_t as_bit; // index of the bit in Flag_Context.bits
 } Flag_Value;
 
 typedef enum {
@@ -63,6 +155,7 @@ typedef enum {
     FLAG_ERROR_INVALID_NUMBER,
     FLAG_ERROR_INTEGER_OVERFLOW,
     FLAG_ERROR_INVALID_SIZE_SUFFIX,
+    FLAG_ERROR_INVALID_BOOL,
     COUNT_FLAG_ERRORS,
 } Flag_Error;
 
@@ -82,6 +175,11 @@ typedef struct {
     Flag flags[FLAGS_CAP];
     size_t flags_count;
 
+    // NOTE: flag_bit_align() may leave the rest of a word unused, so in the
+    // worst case every bit flag takes a word of its own
+    uint64_t bits[FLAGS_CAP];
+    size_t bits_count;
+
     Flag_Error flag_error;
     char *flag_error_name;
 
@@ -143,13 +241,63 @@ char **flag_str(const char *name, const char *def, const char *desc)
     return &flag->val.as_str;
 }
 
-static char *flag_shift_args(int *argc, char ***argv)
+static Flag_Bit flag_bit_of(Flag *flag)
+{
+    Flag_Context *c = &flag_global_context;
+    assert(flag->type == FLAG_BIT);
+    Flag_Bit bit;
+    bit.word = &c->bits[flag->val.as_bit/64];
+    bit.mask = (uint64_t) 1 << (flag->val.as_bit%64);
+    bit.index = (size_t) (flag - c->flags);
+    return bit;
+}
+
+static void flag_bit_set(Flag *flag, bool value)
+{
+    Flag_Bit bit = flag_bit_of(flag);
+    if (value) {
+        *bit.word |= bit.mask;
+    } else {
+        *bit.word &= ~bit.mask;
+    }
+}
+
+Flag_Bit flag_bit(const char *name, bool def, const char *desc)
+{
+    Flag_Context *c = &flag_global_context;
+    Flag *flag = flag_new(FLAG_BIT, name, desc);
+    // NOTE: every bit is also a flag and takes at most one word, so the bank
+    // can't run out before the flags do
+    flag->val.as_bit = c->bits_count++;
+    flag->def.as_bool = def;
+    flag_bit_set(flag, def);
+    return flag_bit_of(flag);
+}
+
+void flag_bit_align(void)
+{
+    Flag_Context *c = &flag_global_context;
+    c->bits_count = (c->bits_count + 63)/64*64;
+}
+
+Flag_Bit flag_bit_group(Flag_Bit a, Flag_Bit b)
 {
-    assert(*argc > 0);
-    char *result = **argv;
-    *argv += 1;
-    *argc -= 1;
-    return result;
+    // NOTE: not an assert, a split group silently checking only some of its
+    // flags in release builds is worse than refusing to start
+    if (a.word != b.word) {
+        fprintf(stderr, "ERROR: -%s and -%s are in different words of the bool bank, call flag_bit_align() before registering the group\n",
+                flag_bit_name(a), flag_bit_name(b));
+        exit(69);
+    }
+    a.mask |= b.mask;
+    return a;
+}
+
+char *flag_bit_name(Flag_Bit bit)
+{
+    Flag_Context *c = &flag_global_context;
+    assert(bit.index < c->flags_count && c->flags[bit.index].type == FLAG_BIT);
+    return c->flags[bit.index].name;
 }
 
 int flag_rest_argc(void)
@@ -162,60 +310,159 @@ char **flag_rest_argv(void)
     return flag_global_context.rest_argv;
 }
 
-bool flag_parse(int argc, char **argv)
+static void flag_iter_flush(Flag_Iter *it)
 {
-    Flag_Context *c = &flag_global_context;
+    if (it->index < 0) return;
+    if (!it->consumed) {
+        // NOTE: out never gets ahead of index, so nothing unread is overwritten
+        for (int i = it->index; i < it->next; ++i) {
+            it->argv[it->out++] = it->argv[i];
+        }
+    }
+    it->index = -1;
+}
 
-    flag_shift_args(&argc, &argv);
+Flag_Iter flag_iter_begin(int argc, char **argv)
+{
+    Flag_Iter it;
+    memset(&it, 0, sizeof(it));
+    it.argc = argc;
+    it.argv = argv;
+    // NOTE: skip the program name
+    it.next = argc > 0 ? 1 : 0;
+    it.out = it.next;
+    it.rest = it.next;
+    it.index = -1;
+    return it;
+}
 
-    while (argc > 0) {
-        char *flag = flag_shift_args(&argc, &argv);
+bool flag_iter_next(Flag_Iter *it)
+{
+    flag_iter_flush(it);
 
-        if (*flag != '-') {
-            // NOTE: pushing flag back into args
-            c->rest_argc = argc + 1;
-            c->rest_argv = argv - 1;
-            return true;
-        }
+    if (it->next >= it->argc) {
+        it->rest = it->next;
+        return false;
+    }
 
-        if (strcmp(flag, "--") == 0) {
-            // NOTE: but if it's the terminator we don't need to push it back
-            c->rest_argc = argc;
-            c->rest_argv = argv;
-            return true;
-        }
+    char *flag = it->argv[it->next];
+
+    // NOTE: a lone "-" is not a flag but the usual name for stdin/stdout,
+    // so it starts the positional arguments like any other non-flag token
+    if (*flag != '-' || flag[1] == '\0') {
+        it->rest = it->next;
+        return false;
+    }
 
-        // NOTE: remove the dash
-        flag += 1;
+    if (strcmp(flag, "--") == 0) {
+        // NOTE: the terminator itself is not a part of the rest
+        it->rest = it->next + 1;
+        return false;
+    }
+
+    it->index = it->next++;
+    it->consumed = false;
+
+    // NOTE: remove the dash
+    it->name = flag + 1;
+
+    char *eq = strchr(it->name, '=');
+    if (eq) {
+        it->name_len = (size_t) (eq - it->name);
+        it->value = eq + 1;
+        it->value_inline = true;
+    } else {
+        it->name_len = strlen(it->name);
+        it->value = it->next < it->argc ? it->argv[it->next] : NULL;
+        it->value_inline = false;
+    }
+
+    return true;
+}
+
+// Returns the value of the current flag and, if it was a separate token,
+// makes that token a part of the current flag. Call it at most once per flag.
+char *flag_iter_shift_value(Flag_Iter *it)
+{
+    assert(it->index >= 0);
+    if (it->value_inline) return it->value;
+    if (it->next >= it->argc) return NULL;
+    return it->argv[it->next++];
+}
+
+void flag_iter_consume(Flag_Iter *it)
+{
+    assert(it->index >= 0);
+    it->consumed = true;
+}
+
+// Moves all the unconsumed tokens, including everything flag_iter_next() did
+// not get to and the "--" terminator, right after argv[0]. argv stays NULL
+// terminated so it can be passed to execvp() as is. Returns the new argc.
+int flag_iter_forward_argv(Flag_Iter *it)
+{
+    flag_iter_flush(it);
+    while (it->next < it->argc) {
+        it->argv[it->out++] = it->argv[it->next++];
+    }
+    it->argv[it->out] = NULL;
+    return it->out;
+}
+
+bool flag_parse(int argc, char **argv)
+{
+    Flag_Context *c = &flag_global_context;
+
+    Flag_Iter it = flag_iter_begin(argc, argv);
+    while (flag_iter_next(&it)) {
+        // NOTE: every flag is consumed, so the iterator never moves anything around in argv
+        flag_iter_consume(&it);
+        char *flag = it.name;
 
         bool found = false;
         for (size_t i = 0; i < c->flags_count; ++i) {
-            if (strcmp(c->flags[i].name, flag) == 0) {
-                static_assert(COUNT_FLAG_TYPES == 4, "Exhaustive flag type parsing");
+            if (strlen(c->flags[i].name) == it.name_len && memcmp(c->flags[i].name, flag, it.name_len) == 0) {
+                static_assert(COUNT_FLAG_TYPES == 5, "Exhaustive flag type parsing");
                 switch (c->flags[i].type) {
-                case FLAG_BOOL: {
-                    c->flags[i].val.as_bool = true;
+                case FLAG_BOOL:
+                case FLAG_BIT: {
+                    bool value;
+                    if (!it.value_inline || strcmp(it.value, "true") == 0) {
+                        value = true;
+                    } else if (strcmp(it.value, "false") == 0) {
+                        value = false;
+                    } else {
+                        c->flag_error = FLAG_ERROR_INVALID_BOOL;
+                        c->flag_error_name = flag;
+                        return false;
+                    }
+
+                    if (c->flags[i].type == FLAG_BIT) {
+                        flag_bit_set(&c->flags[i], value);
+                    } else {
+                        c->flags[i].val.as_bool = value;
+                    }
                 }
                 break;
 
                 case FLAG_STR: {
-                    if (argc == 0) {
+                    char *arg = flag_iter_shift_value(&it);
+                    if (arg == NULL) {
                         c->flag_error = FLAG_ERROR_NO_VALUE;
                         c->flag_error_name = flag;
                         return false;
                     }
-                    char *arg = flag_shift_args(&argc, &argv);
                     c->flags[i].val.as_str = arg;
                 }
                 break;
 
                 case FLAG_UINT64: {
-                    if (argc == 0) {
+                    char *arg = flag_iter_shift_value(&it);
+                    if (arg == NULL) {
                         c->flag_error = FLAG_ERROR_NO_VALUE;
                         c->flag_error_name = flag;
                         return false;
                     }
-                    char *arg = flag_shift_args(&argc, &argv);
 
                     static_assert(sizeof(unsigned long long int) == sizeof(uint64_t), "The original author designed this for x86_64 machine with the compiler that expects unsigned long long int and uint64_t to be the same thing, so they could use strtoull() function to parse it. Please adjust this code for your case and maybe even send the patch to upstream to make it work on a wider range of environments.");
                     char *endptr;
@@ -240,12 +487,12 @@ bool flag_parse(int argc, char **argv)
                 break;
 
                 case FLAG_SIZE: {
-                    if (argc == 0) {
+                    char *arg = flag_iter_shift_value(&it);
+                    if (arg == NULL) {
                         c->flag_error = FLAG_ERROR_NO_VALUE;
                         c->flag_error_name = flag;
                         return false;
                     }
-                    char *arg = flag_shift_args(&argc, &argv);
 
                     static_assert(sizeof(unsigned long long int) == sizeof(size_t), "The original author designed this for x86_64 machine with the compiler that expects unsigned long long int and size_t to be the same thing, so they could use strtoull() function to parse it. Please adjust this code for your case and maybe even send the patch to upstream to make it work on a wider range of environments.");
                     char *endptr;
@@ -290,6 +537,7 @@ bool flag_parse(int argc, char **argv)
                 }
 
                 found = true;
+                break;
             }
         }
 
@@ -300,8 +548,8 @@ bool flag_parse(int argc, char **argv)
         }
     }
 
-    c->rest_argc = argc;
-    c->rest_argv = argv;
+    c->rest_argc = argc - it.rest;
+    c->rest_argv = argv + it.rest;
     return true;
 }
 
@@ -313,9 +561,10 @@ void flag_print_options(FILE *stream)
 
         fprintf(stream, "    -%s\n", flag->name);
         fprintf(stream, "        %s\n", flag->desc);
-        static_assert(COUNT_FLAG_TYPES == 4, "Exhaustive flag type defaults printing");
+        static_assert(COUNT_FLAG_TYPES == 5, "Exhaustive flag type defaults printing");
         switch (c->flags[i].type) {
         case FLAG_BOOL:
+        case FLAG_BIT:
             if (flag->def.as_bool) {
                 fprintf(stream, "        Default: %s\n", flag->def.as_bool ? "true" : "false");
             }
@@ -338,29 +587,81 @@ void flag_print_options(FILE *stream)
     }
 }
 
+// Prints the current values of all the flags one per line as -name=value so
+// the effective configuration of different processes can be compared with
+// flagdiff. Backslashes and newlines in strings are escaped as \\ and \n.
+// A NULL string is printed as just -name.
+void flag_print_snapshot(FILE *stream)
+{
+    Flag_Context *c = &flag_global_context;
+    for (size_t i = 0; i < c->flags_count; ++i) {
+        Flag *flag = &c->flags[i];
+
+        static_assert(COUNT_FLAG_TYPES == 5, "Exhaustive flag type snapshot printing");
+        switch (flag->type) {
+        case FLAG_BOOL:
+            fprintf(stream, "-%s=%s\n", flag->name, flag->val.as_bool ? "true" : "false");
+            break;
+        case FLAG_BIT:
+            fprintf(stream, "-%s=%s\n", flag->name, flag_bit_test(flag_bit_of(flag)) ? "true" : "false");
+            break;
+        case FLAG_UINT64:
+            fprintf(stream, "-%s=%" PRIu64 "\n", flag->name, flag->val.as_uint64);
+            break;
+        case FLAG_SIZE:
+            fprintf(stream, "-%s=%zu\n", flag->name, flag->val.as_size);
+            break;
+        case FLAG_STR:
+            fprintf(stream, "-%s", flag->name);
+            if (flag->val.as_str) {
+                fputc('=', stream);
+                for (const char *s = flag->val.as_str; *s; ++s) {
+                    if (*s == '\\') {
+                        fputs("\\\\", stream);
+                    } else if (*s == '\n') {
+                        fputs("\\n", stream);
+                    } else {
+                        fputc(*s, stream);
+                    }
+                }
+            }
+            fputc('\n', stream);
+            break;
+        default:
+            assert(0 && "unreachable");
+            exit(69);
+        }
+    }
+}
+
 void flag_print_error(FILE *stream)
 {
     Flag_Context *c = &flag_global_context;
-    static_assert(COUNT_FLAG_ERRORS == 6, "Exhaustive flag error printing");
+    // NOTE: the name points into argv and may be followed by =value
+    int name_len = c->flag_error_name ? (int) strcspn(c->flag_error_name, "=") : 0;
+    static_assert(COUNT_FLAG_ERRORS == 7, "Exhaustive flag error printing");
     switch (c->flag_error) {
     case FLAG_NO_ERROR:
         // NOTE: don't call flag_print_error() if flag_parse() didn't return false, okay? ._.
         fprintf(stream, "Operation Failed Successfully! Please tell the developer of this software that they don't know what they are doing! :)");
         break;
     case FLAG_ERROR_UNKNOWN:
-        fprintf(stream, "ERROR: -%s: unknown flag\n", c->flag_error_name);
+        fprintf(stream, "ERROR: -%.*s: unknown flag\n", name_len, c->flag_error_name);
         break;
     case FLAG_ERROR_NO_VALUE:
-        fprintf(stream, "ERROR: -%s: no value provided\n", c->flag_error_name);
+        fprintf(stream, "ERROR: -%.*s: no value provided\n", name_len, c->flag_error_name);
         break;
     case FLAG_ERROR_INVALID_NUMBER:
-        fprintf(stream, "ERROR: -%s: invalid number\n", c->flag_error_name);
+        fprintf(stream, "ERROR: -%.*s: invalid number\n", name_len, c->flag_error_name);
         break;
     case FLAG_ERROR_INTEGER_OVERFLOW:
-        fprintf(stream, "ERROR: -%s: integer overflow\n", c->flag_error_name);
+        fprintf(stream, "ERROR: -%.*s: integer overflow\n", name_len, c->flag_error_name);
         break;
     case FLAG_ERROR_INVALID_SIZE_SUFFIX:
-        fprintf(stream, "ERROR: -%s: invalid size suffix\n", c->flag_error_name);
+        fprintf(stream, "ERROR: -%.*s: invalid size suffix\n", name_len, c->flag_error_name);
+        break;
+    case FLAG_ERROR_INVALID_BOOL:
+        fprintf(stream, "ERROR: -%.*s: invalid boolean, expected true or false\n", name_len, c->flag_error_name);
         break;
     case COUNT_FLAG_ERRORS:
     default:
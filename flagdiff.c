@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FLAG_IMPLEMENTATION
+#include "./flag.h"
+
+// flagdiff -- compare snapshots produced by flag_print_snapshot()
+
+typedef struct {
+    const char *name;
+    size_t name_len;
+    uint64_t name_hash;
+    const char *value;  // NULL if the snapshot line had no =value
+    size_t value_len;
+    uint64_t value_hash;
+} Snapshot_Entry;
+
+typedef struct {
+    const char *path;
+    char *data;
+    Snapshot_Entry *entries;
+    size_t count;
+} Snapshot;
+
+void usage(FILE *stream)
+{
+    fprintf(stream, "Usage: ./flagdiff [OPTIONS] [--] <BASE> <SNAPSHOTS...>\n");
+    fprintf(stream, "    A snapshot path of - reads the snapshot from stdin.\n");
+    fprintf(stream, "    Compares every snapshot against BASE and prints the flags that differ.\n");
+    fprintf(stream, "    Exits with 0 if nothing differs, 1 if something does and 2 on errors.\n");
+    fprintf(stream, "OPTIONS:\n");
+    flag_print_options(stream);
+}
+
+uint64_t fnv1a(const char *data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void snapshot_free(Snapshot *s)
+{
+    free(s->data);
+    free(s->entries);
+    memset(s, 0, sizeof(*s));
+}
+
+bool snapshot_load(Snapshot *s, const char *path)
+{
+    memset(s, 0, sizeof(*s));
+    s->path = path;
+
+    bool is_stdin = strcmp(path, "-") == 0;
+    FILE *f = is_stdin ? stdin : fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // NOTE: no fseek()/ftell() here, so pipes like <(ssh host dump) work too
+    size_t n = 0;
+    size_t cap = 4096;
+    s->data = (char*) malloc(cap);
+    assert(s->data);
+    for (;;) {
+        if (n + 1 >= cap) {
+            cap *= 2;
+            s->data = (char*) realloc(s->data, cap);
+            assert(s->data);
+        }
+        size_t m = fread(s->data + n, 1, cap - n - 1, f);
+        n += m;
+        if (m == 0) break;
+    }
+
+    bool failed = ferror(f) != 0;
+    if (!is_stdin) fclose(f);
+    if (failed) {
+        fprintf(stderr, "ERROR: could not read file %s: %s\n", path, strerror(errno));
+        snapshot_free(s);
+        return false;
+    }
+    s->data[n] = '\0';
+
+    size_t lines = 0;
+    for (size_t i = 0; i < n; ++i) lines += s->data[i] == '\n';
+    s->entries = (Snapshot_Entry*) malloc((lines + 1)*sizeof(*s->entries));
+    assert(s->entries);
+
+    char *line = s->data;
+    char *end = s->data + n;
+    for (size_t row = 1; line < end; ++row) {
+        char *eol = (char*) memchr(line, '\n', (size_t) (end - line));
+        if (eol == NULL) eol = end;
+
+        if (eol > line) {
+            if (*line != '-') {
+                fprintf(stderr, "%s:%zu: ERROR: expected -name=value\n", path, row);
+                snapshot_free(s);
+                return false;
+            }
+
+            Snapshot_Entry *e = &s->entries[s->count++];
+            e->name = line + 1;
+            char *eq = (char*) memchr(e->name, '=', (size_t) (eol - e->name));
+            if (eq) {
+                e->name_len = (size_t) (eq - e->name);
+                e->value = eq + 1;
+                e->value_len = (size_t) (eol - e->value);
+                e->value_hash = fnv1a(e->value, e->value_len);
+            } else {
+                e->name_len = (size_t) (eol - e->name);
+                e->value = NULL;
+                e->value_len = 0;
+                e->value_hash = 0;
+            }
+            e->name_hash = fnv1a(e->name, e->name_len);
+        }
+
+        line = eol + 1;
+    }
+
+    return true;
+}
+
+bool snapshot_entry_same_name(const Snapshot_Entry *a, const Snapshot_Entry *b)
+{
+    return a->name_hash == b->name_hash
+           && a->name_len == b->name_len
+           && memcmp(a->name, b->name, a->name_len) == 0;
+}
+
+bool snapshot_entry_same_value(const Snapshot_Entry *a, const Snapshot_Entry *b)
+{
+    // NOTE: a hash mismatch rejects the value without touching its bytes.
+    // memcmp() only runs when the hashes match, to rule out collisions.
+    if ((a->value == NULL) != (b->value == NULL)) return false;
+    return a->value_hash == b->value_hash
+           && a->value_len == b->value_len
+           && memcmp(a->value, b->value, a->value_len) == 0;
+}
+
+void print_entry_value(FILE *stream, const Snapshot_Entry *e)
+{
+    if (e == NULL) {
+        fprintf(stream, "(missing)");
+    } else if (e->value == NULL) {
+        fprintf(stream, "(null)");
+    } else {
+        fprintf(stream, "%.*s", (int) e->value_len, e->value);
+    }
+}
+
+void print_difference(FILE *stream, const Snapshot *a, const Snapshot *b,
+                      const Snapshot_Entry *ea, const Snapshot_Entry *eb)
+{
+    if (stream == NULL) return;
+    const Snapshot_Entry *e = ea ? ea : eb;
+    fprintf(stream, "%s %s: -%.*s: ", a->path, b->path, (int) e->name_len, e->name);
+    print_entry_value(stream, ea);
+    fprintf(stream, " => ");
+    print_entry_value(stream, eb);
+    fprintf(stream, "\n");
+}
+
+// Prints the flags that differ between the snapshots to stream, unless it's
+// NULL, and returns how many of them there are. seen must have room for
+// b->count elements.
+size_t flag_diff(const Snapshot *a, const Snapshot *b, bool *seen, FILE *stream)
+{
+    if (b->count > 0) memset(seen, 0, b->count*sizeof(*seen));
+
+    size_t diffs = 0;
+    for (size_t i = 0; i < a->count; ++i) {
+        const Snapshot_Entry *ea = &a->entries[i];
+        const Snapshot_Entry *eb = NULL;
+
+        // NOTE: snapshots of the same program list the flags in the same
+        // order, so the entry at the same position is almost always the one
+        if (i < b->count && !seen[i] && snapshot_entry_same_name(ea, &b->entries[i])) {
+            eb = &b->entries[i];
+        } else {
+            for (size_t j = 0; j < b->count; ++j) {
+                if (!seen[j] && snapshot_entry_same_name(ea, &b->entries[j])) {
+                    eb = &b->entries[j];
+                    break;
+                }
+            }
+        }
+
+        if (eb) seen[eb - b->entries] = true;
+
+        if (eb == NULL || !snapshot_entry_same_value(ea, eb)) {
+            print_difference(stream, a, b, ea, eb);
+            diffs += 1;
+        }
+    }
+
+    for (size_t j = 0; j < b->count; ++j) {
+        if (!seen[j]) {
+            print_difference(stream, a, b, NULL, &b->entries[j]);
+            diffs += 1;
+        }
+    }
+
+    return diffs;
+}
+
+int main(int argc, char **argv)
+{
+    bool *help = flag_bool("help", false, "Print this help to stdout and exit with 0");
+    bool *pairs = flag_bool("pairs", false, "Compare the snapshots in pairs: 1st with 2nd, 3rd with 4th and so on, instead of against the first one");
+    bool *quiet = flag_bool("quiet", false, "Don't print the differences, only count them");
+
+    if (!flag_parse(argc, argv)) {
+        usage(stderr);
+        flag_print_error(stderr);
+        exit(2);
+    }
+
+    if (*help) {
+        usage(stdout);
+        exit(0);
+    }
+
+    int rest_argc = flag_rest_argc();
+    char **rest_argv = flag_rest_argv();
+
+    if (rest_argc < 2) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: at least two snapshots are required\n");
+        exit(2);
+    }
+
+    if (*pairs && rest_argc%2 != 0) {
+        usage(stderr);
+        fprintf(stderr, "ERROR: -%s requires an even amount of snapshots\n", flag_name(pairs));
+        exit(2);
+    }
+
+    FILE *stream = *quiet ? NULL : stdout;
+    bool *seen = NULL;
+    size_t seen_cap = 0;
+    size_t total = 0;
+    size_t compared = 0;
+
+    Snapshot a = {0}, b = {0};
+    for (int i = 1; i < rest_argc; ++i) {
+        if (a.data == NULL) {
+            if (!snapshot_load(&a, rest_argv[i - 1])) exit(2);
+        }
+        if (!snapshot_load(&b, rest_argv[i])) exit(2);
+
+        if (b.count > seen_cap) {
+            seen_cap = b.count;
+            seen = (bool*) realloc(seen, seen_cap*sizeof(*seen));
+            assert(seen);
+        }
+
+        total += flag_diff(&a, &b, seen, stream);
+        compared += 1;
+
+        snapshot_free(&b);
+        if (*pairs) {
+            snapshot_free(&a);
+            i += 1;
+        }
+    }
+    snapshot_free(&a);
+    free(seen);
+
+    fprintf(stderr, "%zu differences in %zu comparisons\n", total, compared);
+    return total > 0 ? 1 : 0;
+}